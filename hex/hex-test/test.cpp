@@ -1,6 +1,7 @@
 #include "pch.h"
 
-#include "../hex/hex.h"
+#include "../hexlib/hex.h"
+#include "../hexlib/hex_c.h"
 
 namespace {
 	class BoardTest : public ::testing::Test
@@ -15,29 +16,54 @@ namespace {
 		int size{ 10 };
 		Board b(size);
 
-		EXPECT_EQ(0, b.get_node(Point(0, 0)));
-		EXPECT_EQ(size*size, b.get_node(Point(size, 0)));
-		EXPECT_EQ(size, b.get_node(Point(0, size)));
-		EXPECT_EQ(size*size + size, b.get_node(Point(size, size)));
+		EXPECT_EQ(0, b.get_node(Coord(0, 0)));
+		EXPECT_EQ(size*size, b.get_node(Coord(size, 0)));
+		EXPECT_EQ(size, b.get_node(Coord(0, size)));
+		EXPECT_EQ(size*size + size, b.get_node(Coord(size, size)));
+	}
+
+	TEST(BoardTest, TestCellRowCol) {
+		int size{ 10 };
+		Board b(size);
+
+		EXPECT_EQ(b.get_node(Coord(3, 7)), b.cell(3, 7));
+		EXPECT_EQ(3, b.row(b.cell(3, 7)));
+		EXPECT_EQ(7, b.col(b.cell(3, 7)));
+		EXPECT_EQ(size*size - 1, b.cell(size - 1, size - 1));
+	}
+
+	TEST(BoardTest, TestNeighborAt) {
+		int size{ 5 };
+		Board b(size);
+
+		// Top left corner only has right and lower right, see getNeighbor.
+		EXPECT_EQ(1, b.neighborAt(0, 0));
+		EXPECT_EQ(-1, b.neighborAt(0, 1));
+		EXPECT_EQ(-1, b.neighborAt(0, 3));
+		EXPECT_EQ(5, b.neighborAt(0, 5));
+		// Node 6 is on an odd row, so it leans right.
+		EXPECT_EQ(2, b.neighborAt(6, 1));
+		EXPECT_EQ(1, b.neighborAt(6, 2));
+		EXPECT_EQ(12, b.neighborAt(6, 5));
 	}
 
 	TEST(BoardTest, TestIsCorner) {
 		int size{ 10 };
 		Board b(size);
 
-		EXPECT_TRUE(b.isCorner(Point(0, 0)));
-		EXPECT_TRUE(b.isCorner(Point(0, 9)));
-		EXPECT_TRUE(b.isCorner(Point(9, 0)));
-		EXPECT_TRUE(b.isCorner(Point(9, 9)));
+		EXPECT_TRUE(b.isCorner(Coord(0, 0)));
+		EXPECT_TRUE(b.isCorner(Coord(0, 9)));
+		EXPECT_TRUE(b.isCorner(Coord(9, 0)));
+		EXPECT_TRUE(b.isCorner(Coord(9, 9)));
 	}
 
 	TEST(BoardTest, TestNotCorner) {
 		int size{ 10 };
 		Board b(size);
 
-		EXPECT_FALSE(b.isCorner(Point(1, 1)));
-		EXPECT_FALSE(b.isCorner(Point(0, 10)));
-		EXPECT_FALSE(b.isCorner(Point(5, 0)));
+		EXPECT_FALSE(b.isCorner(Coord(1, 1)));
+		EXPECT_FALSE(b.isCorner(Coord(0, 10)));
+		EXPECT_FALSE(b.isCorner(Coord(5, 0)));
 	}
 
 	TEST(BoardTest, TestIsOccupied) {
@@ -51,40 +77,997 @@ namespace {
 		int size{ 10 };
 		Board b(size);
 
-		EXPECT_TRUE(b.isWithinBoundary(Point(0, 0)));
-		EXPECT_TRUE(b.isWithinBoundary(Point(size-1, size-1)));
-		EXPECT_TRUE(b.isWithinBoundary(Point(0, size-1)));
-		EXPECT_TRUE(b.isWithinBoundary(Point(size-1, 0)));
-		EXPECT_TRUE(b.isWithinBoundary(Point(5, 0)));
+		EXPECT_TRUE(b.isWithinBoundary(Coord(0, 0)));
+		EXPECT_TRUE(b.isWithinBoundary(Coord(size-1, size-1)));
+		EXPECT_TRUE(b.isWithinBoundary(Coord(0, size-1)));
+		EXPECT_TRUE(b.isWithinBoundary(Coord(size-1, 0)));
+		EXPECT_TRUE(b.isWithinBoundary(Coord(5, 0)));
 	}
 
 	TEST(BoardTest, TestNotIsWithinBoundary) {
 		int size{ 10 };
 		Board b(size);
 
-		EXPECT_FALSE(b.isWithinBoundary(Point(0, size)));
-		EXPECT_FALSE(b.isWithinBoundary(Point(size, size)));
-		EXPECT_FALSE(b.isWithinBoundary(Point(0, size)));
-		EXPECT_FALSE(b.isWithinBoundary(Point(size, 0)));
-		EXPECT_FALSE(b.isWithinBoundary(Point(-1, size+1)));
+		EXPECT_FALSE(b.isWithinBoundary(Coord(0, size)));
+		EXPECT_FALSE(b.isWithinBoundary(Coord(size, size)));
+		EXPECT_FALSE(b.isWithinBoundary(Coord(0, size)));
+		EXPECT_FALSE(b.isWithinBoundary(Coord(size, 0)));
+		EXPECT_FALSE(b.isWithinBoundary(Coord(-1, size+1)));
 	}
 
 	TEST(BoardTest, TestIsAvailable) {
 		int size{ 10 };
 		Board b(size);
 
-		EXPECT_TRUE(b.isAvailable(Point(0, 0)));
-		EXPECT_TRUE(b.isAvailable(Point(5, 0)));
+		EXPECT_TRUE(b.isAvailable(Coord(0, 0)));
+		EXPECT_TRUE(b.isAvailable(Coord(5, 0)));
 	}
 
 	TEST(BoardTest, TestNotIsAvailable) {
 		int size{ 10 };
 		Board b(size);
 
-		b.makeMove(Point(0, 0), Color::COLOR_BLUE);
-		EXPECT_FALSE(b.isAvailable(Point(0, 0)));
-		b.makeMove(Point(5, 0), Color::COLOR_RED);
-		EXPECT_FALSE(b.isAvailable(Point(5, 0)));
+		b.setColor(b.get_node(Coord(0, 0)), Color::COLOR_BLUE);
+		EXPECT_FALSE(b.isAvailable(Coord(0, 0)));
+		b.setColor(b.get_node(Coord(5, 0)), Color::COLOR_RED);
+		EXPECT_FALSE(b.isAvailable(Coord(5, 0)));
+	}
+
+	TEST(BoardTest, TestNoWinnerOnEmptyBoard) {
+		Board b(5);
+
+		EXPECT_EQ(Color::COLOR_BLANK, b.winner());
+	}
+
+	TEST(BoardTest, TestBlueWinsAcrossARow) {
+		int size{ 5 };
+		Board b(size);
+
+		for (int col = 0; col < size; ++col)
+		{
+			b.setColor(b.get_node(Coord(2, col)), Color::COLOR_BLUE);
+		}
+		EXPECT_EQ(Color::COLOR_BLUE, b.winner());
+	}
+
+	TEST(BoardTest, TestRedWinsDownAColumn) {
+		int size{ 5 };
+		Board b(size);
+
+		for (int row = 0; row < size; ++row)
+		{
+			b.setColor(b.get_node(Coord(row, 3)), Color::COLOR_RED);
+		}
+		EXPECT_EQ(Color::COLOR_RED, b.winner());
+	}
+
+	TEST(BoardTest, TestHashFollowsStones) {
+		Board b(5);
+		std::uint64_t empty = b.hash();
+
+		b.setColor(7, Color::COLOR_BLUE);
+		EXPECT_NE(empty, b.hash());
+		b.setColor(7, Color::COLOR_BLANK);
+		EXPECT_EQ(empty, b.hash());
+	}
+
+	TEST(BoardTest, TestConnectivityAgreesWithWinner) {
+		// Random games on a large board, checked after every stone.
+		int size{ 19 };
+		Random r;
+		for (int game = 0; game < 5; ++game)
+		{
+			Board b(size);
+			Connectivity connect(size);
+			std::vector<int> nodes(size * size);
+			for (int n = 0; n < size * size; ++n)
+			{
+				nodes[n] = n;
+			}
+			r.shuffle(nodes);
+			Color c{ Color::COLOR_BLUE };
+			for (auto n : nodes)
+			{
+				b.setColor(n, c);
+				connect.play(b, n);
+				ASSERT_EQ(b.winner(), connect.winner());
+				c = (Color::COLOR_BLUE == c) ? Color::COLOR_RED : Color::COLOR_BLUE;
+			}
+		}
+	}
+
+	TEST(SearchTest, TestUctRecyclesAFullArena) {
+		Board b(7);
+		UctSearch search(256);
+
+		search.start(b, Color::COLOR_BLUE);
+		search.step(b, 5000, 60.0);
+		EXPECT_EQ(5000, search.played());
+		EXPECT_GT(search.recycled(), 0);
+		EXPECT_LE(search.nodes(), 256u);
+		int move = search.best();
+		EXPECT_GE(move, 0);
+		EXPECT_LT(move, 49);
+	}
+
+	TEST(SearchTest, TestUctWidensInPriorOrder) {
+		Board b(13);
+		UctSearch widened;
+		UctSearch flat;
+
+		flat.setWidening(false);
+		widened.start(b, Color::COLOR_BLUE);
+		flat.start(b, Color::COLOR_BLUE);
+		widened.step(b, 2000, 60.0);
+		flat.step(b, 2000, 60.0);
+		EXPECT_EQ(2000, widened.played());
+		// Past the root the flat tree gets all of every node's children.
+		EXPECT_LT(widened.nodes() * 2, flat.nodes());
+		int move = widened.best();
+		EXPECT_GE(move, 0);
+		EXPECT_LT(move, 169);
+		// With one playout the best prior is tried: next to blue's own stone
+		// in the middle rather than next to red's in the corner.
+		b.setColor(b.cell(6, 6), Color::COLOR_BLUE);
+		b.setColor(b.cell(0, 0), Color::COLOR_RED);
+		widened.start(b, Color::COLOR_BLUE);
+		widened.step(b, 1, 60.0);
+		bool next{ false };
+		for (int dir = 0; dir < 6; ++dir)
+		{
+			next = next || widened.best() == b.neighborAt(b.cell(6, 6), dir);
+		}
+		EXPECT_TRUE(next);
+	}
+
+	TEST(SearchTest, TestResistanceFollowsConnections) {
+		ResistanceEvaluator e;
+		Board b(7);
+
+		double empty = e.evaluate(b);
+		EXPECT_GT(empty, 0.3);
+		EXPECT_LT(empty, 0.7);
+		for (int col = 0; col < 7; ++col)
+		{
+			b.setColor(b.cell(3, col), Color::COLOR_BLUE);
+		}
+		EXPECT_GT(e.evaluate(b), 0.99);
+	}
+
+	TEST(SearchTest, TestResistanceWarmStartAndBatch) {
+		ResistanceEvaluator e;
+		Board b(11);
+		Potentials root;
+		Potentials cold;
+		Potentials warm;
+
+		b.setColor(60, Color::COLOR_BLUE);
+		b.setColor(61, Color::COLOR_RED);
+		e.evaluate(b, nullptr, &root);
+		Board child = b;
+		child.setColor(50, Color::COLOR_BLUE);
+		double value = e.evaluate(child, nullptr, &cold);
+		EXPECT_NEAR(value, e.evaluate(child, &root, &warm), 1e-3);
+		EXPECT_LT(warm.iterations, cold.iterations);
+
+		const Board* boards[2]{ &b, &child };
+		double values[2];
+		e.evaluate(boards, 2, values);
+		EXPECT_DOUBLE_EQ(e.evaluate(b), values[0]);
+		EXPECT_DOUBLE_EQ(value, values[1]);
+	}
+
+	TEST(SearchTest, TestUctScoresLeavesInBatches) {
+		ResistanceEvaluator evaluator;
+		Board b(5);
+		UctSearch search;
+
+		search.setEvaluator(&evaluator, 8);
+		search.start(b, Color::COLOR_RED);
+		// The last batch is cut to fit the budget.
+		search.step(b, 403, 60.0);
+		EXPECT_EQ(403, search.played());
+		// Descents that end the game aren't sent to the evaluator.
+		EXPECT_LE(search.batches(), 51);
+		EXPECT_GT(search.batches(), 0);
+		int move = search.best();
+		EXPECT_GE(move, 0);
+		EXPECT_LT(move, 25);
+	}
+
+	TEST(SearchTest, TestSwapTableRoundTrip) {
+		SwapTable table;
+		SwapTable loaded;
+
+		EXPECT_FALSE(table.has(3));
+		EXPECT_EQ(-1.0, table.rate(3, 4));
+		table.generate(3, 50);
+		ASSERT_TRUE(table.save("swap-test.hxw"));
+		ASSERT_TRUE(loaded.load("swap-test.hxw"));
+		EXPECT_TRUE(loaded.has(3));
+		for (int n = 0; n < 9; ++n)
+		{
+			EXPECT_EQ(table.rate(3, n), loaded.rate(3, n));
+			EXPECT_GE(loaded.rate(3, n), 0.0);
+			EXPECT_LE(loaded.rate(3, n), 1.0);
+		}
+		std::remove("swap-test.hxw");
+	}
+
+	// Plain minimax over the whole game tree, slow but obviously right.
+	static Color solve(Board& b, Color c)
+	{
+		Color winner = b.winner();
+		if (Color::COLOR_BLANK != winner)
+		{
+			return winner;
+		}
+		Color other = (Color::COLOR_BLUE == c) ? Color::COLOR_RED : Color::COLOR_BLUE;
+		for (int n = 0; n < b.size() * b.size() && Color::COLOR_BLANK == winner; ++n)
+		{
+			if (b.isBlank(n))
+			{
+				b.setColor(n, c);
+				if (c == solve(b, other))
+				{
+					winner = c;
+				}
+				b.setColor(n, Color::COLOR_BLANK);
+			}
+		}
+		return (Color::COLOR_BLANK == winner) ? other : winner;
+	}
+
+	TEST(SearchTest, TestTablebaseAgreesWithMinimax) {
+		Tablebase table;
+		Random r;
+
+		EXPECT_LT(Tablebase::bits(5), 0);
+		EXPECT_FALSE(table.open("missing.hxt"));
+		ASSERT_TRUE(Tablebase::build(3, "table-test.hxt"));
+		ASSERT_TRUE(table.open("table-test.hxt"));
+		Board b(3);
+		// The first player always wins.
+		EXPECT_EQ(Color::COLOR_BLUE, table.winner(b));
+		for (int game = 0; game < 20; ++game)
+		{
+			b.clear();
+			Color c{ Color::COLOR_BLUE };
+			for (int stones = r.getRandom(0, 8); stones > 0; --stones)
+			{
+				int n;
+				do
+				{
+					n = r.getRandom(0, 8);
+				} while (b.isOccupied(n));
+				b.setColor(n, c);
+				c = (Color::COLOR_BLUE == c) ? Color::COLOR_RED : Color::COLOR_BLUE;
+			}
+			Board copy = b;
+			Color winner = solve(copy, c);
+			ASSERT_EQ(winner, table.winner(b));
+			int move = table.bestMove(b, c);
+			if (winner == c && Color::COLOR_BLANK == b.winner())
+			{
+				ASSERT_GE(move, 0);
+				ASSERT_TRUE(b.isBlank(move));
+				b.setColor(move, c);
+				EXPECT_EQ(c, table.winner(b));
+			}
+			else if (winner != c)
+			{
+				EXPECT_EQ(-1, move);
+			}
+		}
+		// Two blue stones and no red one can't come up.
+		b.clear();
+		b.setColor(0, Color::COLOR_BLUE);
+		b.setColor(1, Color::COLOR_BLUE);
+		EXPECT_EQ(-1, table.index(b));
+		EXPECT_EQ(-1, table.index(Board(4)));
+		std::remove("table-test.hxt");
+	}
+
+	TEST(CApiTest, TestPlayAndWinners) {
+		hex_board* boards[2]{ hex_board_new(3), hex_board_new(3) };
+		int row[3]{ 3, 0, 4 };
+		int winners[2];
+
+		EXPECT_EQ(HEX_API_VERSION, hex_api_version());
+		// Blue plays 3, red 0 and blue 4, which then is taken.
+		EXPECT_EQ(3, hex_board_play(boards[0], row, 3, HEX_BLUE));
+		EXPECT_EQ(0, hex_board_play(boards[0], row + 2, 1, HEX_BLUE));
+		EXPECT_EQ(HEX_BLUE, hex_board_get(boards[0], 3));
+		EXPECT_EQ(HEX_RED, hex_board_get(boards[0], 0));
+		int last{ 5 };
+		EXPECT_EQ(1, hex_board_play(boards[0], &last, 1, HEX_BLUE));
+		hex_winners(boards, 2, winners);
+		EXPECT_EQ(HEX_BLUE, winners[0]);
+		EXPECT_EQ(HEX_BLANK, winners[1]);
+		hex_board_free(boards[0]);
+		hex_board_free(boards[1]);
+	}
+
+	TEST(CApiTest, TestGenmoveBatch) {
+		hex_board* boards[2]{ hex_board_new(4), hex_board_new(4) };
+		int colors[2]{ HEX_BLUE, HEX_RED };
+		int moves[2];
+		hex_engine* engine = hex_engine_new("random");
+
+		ASSERT_NE(nullptr, engine);
+		EXPECT_EQ(nullptr, hex_engine_new("no such engine"));
+		hex_genmove(engine, boards, colors, 2, 0.0, moves);
+		EXPECT_GE(moves[0], 0);
+		EXPECT_LT(moves[0], 16);
+		EXPECT_GE(moves[1], 0);
+		EXPECT_LT(moves[1], 16);
+		hex_engine_free(engine);
+		hex_board_free(boards[0]);
+		hex_board_free(boards[1]);
+	}
+
+	TEST(TunerTest, TestPatternWeightsRoundTrip) {
+		PatternWeights weights;
+		PatternWeights loaded;
+
+		weights.setGamma(0, 2.5f);
+		weights.setGamma(NumPatterns - 1, 0.25f);
+		ASSERT_TRUE(weights.save("weights-test.bin"));
+		ASSERT_TRUE(loaded.load("weights-test.bin"));
+		for (int p = 0; p < NumPatterns; ++p)
+		{
+			ASSERT_EQ(weights.gamma(p), loaded.gamma(p));
+		}
+		// Not a weights file.
+		{
+			std::ofstream out("weights-test.bin", std::ios::binary);
+			out << "nonsense";
+		}
+		EXPECT_FALSE(loaded.load("weights-test.bin"));
+		EXPECT_EQ(2.5f, loaded.gamma(0));
+		std::remove("weights-test.bin");
+	}
+
+	TEST(TunerTest, TestOneIterationFavorsThePlayedPattern) {
+		// Blue always opens in the middle of a 3x3 board, where every
+		// neighbor is empty (pattern 0).  The other nodes all touch an edge.
+		{
+			std::ofstream out("shard-test.txt");
+			out << "3 1 4" << std::endl << "3 1 4 0" << std::endl << "3 2 4" << std::endl;
+		}
+		Board b(3);
+		PatternTuner tuner({ "shard-test.txt" });
+		tuner.run(1);
+		EXPECT_EQ(4, tuner.moves());
+		EXPECT_GT(tuner.weights().gamma(b.pattern(4, Color::COLOR_BLUE)), 1.0f);
+		EXPECT_LT(tuner.weights().gamma(b.pattern(8, Color::COLOR_BLUE)), 1.0f);
+
+		PatternTuner winners({ "shard-test.txt" }, true);
+		winners.run(1);
+		// Red's reply and the game red won don't count.
+		EXPECT_EQ(2, winners.moves());
+		std::remove("shard-test.txt");
+	}
+
+	TEST(RecordTest, TestBinaryRecordsRoundTrip) {
+		std::remove("records-test.hxr");
+		GameRecordWriter writer;
+		ASSERT_TRUE(writer.open("records-test.hxr"));
+		std::vector<GameRecord> games(3);
+		for (int i = 0; i < 3; ++i)
+		{
+			games[i].size = 13 + i;
+			games[i].winner = (0 == i % 2) ? Color::COLOR_BLUE : Color::COLOR_RED;
+			games[i].blue = "mc";
+			games[i].red = "uct:" + std::to_string(i);
+			// Moves past 127 take two bytes.
+			games[i].moves = { 0, 5, 127, 128, static_cast<Cell>(games[i].size * games[i].size - 1) };
+			writer.write(games[i]);
+		}
+		EXPECT_TRUE(writer.close());
+
+		GameRecordReader reader;
+		ASSERT_TRUE(reader.open("records-test.hxr"));
+		GameRecord g;
+		for (auto& expected : games)
+		{
+			ASSERT_TRUE(reader.next(g));
+			EXPECT_EQ(expected.size, g.size);
+			EXPECT_EQ(expected.winner, g.winner);
+			EXPECT_EQ(expected.blue, g.blue);
+			EXPECT_EQ(expected.red, g.red);
+			EXPECT_EQ(expected.moves, g.moves);
+		}
+		EXPECT_FALSE(reader.next(g));
+		EXPECT_FALSE(reader.corrupt());
+		std::remove("records-test.hxr");
+	}
+
+	TEST(RecordTest, TestFlippedByteIsCaught) {
+		std::remove("records-test.hxr");
+		GameRecordWriter writer;
+		ASSERT_TRUE(writer.open("records-test.hxr"));
+		GameRecord game;
+		game.size = 7;
+		game.winner = Color::COLOR_BLUE;
+		game.moves = { 24, 17, 25 };
+		writer.write(game);
+		ASSERT_TRUE(writer.close());
+		// Past the file header (8 bytes) and the block header (12 bytes),
+		// so the byte is in the payload.
+		{
+			std::fstream file("records-test.hxr", std::ios::in | std::ios::out | std::ios::binary);
+			file.seekg(21);
+			char byte = static_cast<char>(file.get());
+			file.seekp(21);
+			file.put(static_cast<char>(byte ^ 0x40));
+		}
+		GameRecordReader reader;
+		ASSERT_TRUE(reader.open("records-test.hxr"));
+		GameRecord g;
+		EXPECT_FALSE(reader.next(g));
+		EXPECT_TRUE(reader.corrupt());
+		std::remove("records-test.hxr");
+	}
+
+	TEST(BookTest, TestLookupFindsTheRecordedMove) {
+		BookBuilder builder(2, 2);
+		GameRecord won;
+		won.size = 5;
+		won.winner = Color::COLOR_BLUE;
+		won.moves = { 12, 7, 3 };
+		GameRecord lost = won;
+		lost.winner = Color::COLOR_RED;
+		lost.moves = { 0, 7 };
+		builder.add(won);
+		builder.add(won);
+		builder.add(lost);
+		builder.add(lost);
+		// Two moves deep, four games each.
+		EXPECT_EQ(8u, builder.observations());
+		// The empty board and the two positions after blue's openings.
+		ASSERT_EQ(3, builder.write("book-test.hxb"));
+
+		OpeningBook book;
+		ASSERT_TRUE(book.open("book-test.hxb"));
+		EXPECT_EQ(3u, book.size());
+		Board b(5);
+		// Opening 12 won both its games, 0 lost both.
+		EXPECT_EQ(12, book.lookup(b));
+		b.setColor(12, Color::COLOR_BLUE);
+		EXPECT_EQ(7, book.lookup(b));
+		b.setColor(7, Color::COLOR_RED);
+		EXPECT_EQ(-1, book.lookup(b));
+		EXPECT_EQ(-1, book.lookup(Board(7)));
+		std::remove("book-test.hxb");
+	}
+
+	TEST(BookTest, TestBadHeaderIsRejected) {
+		BookBuilder builder(4, 1);
+		GameRecord game;
+		game.size = 5;
+		game.winner = Color::COLOR_BLUE;
+		game.moves = { 12, 7, 3 };
+		builder.add(game);
+		ASSERT_EQ(3, builder.write("book-test.hxb"));
+		{
+			std::fstream file("book-test.hxb", std::ios::in | std::ios::out | std::ios::binary);
+			file.seekp(2);
+			file.put('X');
+		}
+		OpeningBook book;
+		EXPECT_FALSE(book.open("book-test.hxb"));
+		EXPECT_EQ(0u, book.size());
+		// A header claiming more entries than the file holds.
+		ASSERT_EQ(3, builder.write("book-test.hxb"));
+		{
+			std::fstream file("book-test.hxb", std::ios::in | std::ios::out | std::ios::binary);
+			file.seekp(8);
+			file.put(4);
+		}
+		EXPECT_FALSE(book.open("book-test.hxb"));
+		EXPECT_FALSE(book.open("missing.hxb"));
+		std::remove("book-test.hxb");
+	}
+
+	TEST(GtpTest, TestPlayGenmoveUndo) {
+		GtpSession session(makeEngine("random"), 5);
+		std::string response;
+
+		EXPECT_TRUE(session.execute("7 name", response));
+		EXPECT_EQ("=7 hex\n\n", response);
+		session.execute("play b c3", response);
+		EXPECT_EQ("=\n\n", response);
+		session.execute("play w c3", response);
+		EXPECT_EQ("? cell occupied\n\n", response);
+		session.execute("play w f1", response);
+		EXPECT_EQ("? invalid color or coordinate\n\n", response);
+		session.execute("genmove w", response);
+		ASSERT_EQ("= ", response.substr(0, 2));
+		std::string move = response.substr(2, response.size() - 4);
+		EXPECT_NE("c3", move);
+		// The engine's move is on the board now.
+		session.execute("play b " + move, response);
+		EXPECT_EQ("? cell occupied\n\n", response);
+		session.execute("undo", response);
+		EXPECT_EQ("=\n\n", response);
+		session.execute("undo", response);
+		EXPECT_EQ("=\n\n", response);
+		session.execute("undo", response);
+		EXPECT_EQ("? cannot undo\n\n", response);
+		session.execute("play w c3", response);
+		EXPECT_EQ("=\n\n", response);
+		EXPECT_FALSE(session.execute("quit", response));
+	}
+
+	TEST(GtpTest, TestGenmoveResignsOnceConnected) {
+		GtpSession session(makeEngine("random"), 3);
+		std::string response;
+
+		session.execute("play b a1", response);
+		session.execute("play b b1", response);
+		session.execute("play b c1", response);
+		session.execute("genmove w", response);
+		EXPECT_EQ("= resign\n\n", response);
+		// Taking the last stone back breaks the connection again.
+		session.execute("undo", response);
+		session.execute("genmove w", response);
+		EXPECT_NE("= resign\n\n", response);
+		session.execute("clear_board", response);
+		session.execute("genmove w", response);
+		EXPECT_NE("= resign\n\n", response);
+	}
+
+	TEST(GtpTest, TestBoardsizeLimits) {
+		GtpSession session(makeEngine("random"), 5);
+		std::string response;
+
+		for (auto size : { "0", "33", "-1", "7x7", "" })
+		{
+			session.execute(std::string("boardsize ") + size, response);
+			EXPECT_EQ("? unacceptable size\n\n", response) << size;
+		}
+		session.execute("boardsize 32", response);
+		EXPECT_EQ("=\n\n", response);
+		session.execute("play b af32", response);
+		EXPECT_EQ("=\n\n", response);
+		session.execute("play b ag1", response);
+		EXPECT_EQ("? invalid color or coordinate\n\n", response);
+	}
+
+	// Always plays the same node.
+	class FixedEngine : public Engine
+	{
+	private:
+		int m_node;
+	public:
+		FixedEngine(int node) : m_node{ node } {}
+		std::string name() const override { return "fixed"; }
+		int genmove(const Board&, Color, double) override { return m_node; }
+	};
+
+	TEST(GtpTest, TestTimeSettingsAreChecked) {
+		GtpSession session(makeEngine("random"), 5);
+		std::string response;
+
+		session.execute("time_settings 300 5.5 1", response);
+		EXPECT_EQ("=\n\n", response);
+		session.execute("time_settings abc 5 1", response);
+		EXPECT_EQ("? syntax error\n\n", response);
+		session.execute("time_settings 300 -5 1", response);
+		EXPECT_EQ("? syntax error\n\n", response);
+		session.execute("time_settings 300 5 -1", response);
+		EXPECT_EQ("? syntax error\n\n", response);
+		session.execute("time_settings 300 5", response);
+		EXPECT_EQ("? syntax error\n\n", response);
+	}
+
+	TEST(GtpTest, TestTwoLetterColumnsRoundTrip) {
+		// aa30 is column 26 of row 29.
+		GtpSession session(std::unique_ptr<Engine>(new FixedEngine(29 * 32 + 26)), 32);
+		std::string response;
+
+		session.execute("genmove b", response);
+		EXPECT_EQ("= aa30\n\n", response);
+		session.execute("play w aa30", response);
+		EXPECT_EQ("? cell occupied\n\n", response);
+		session.execute("undo", response);
+		session.execute("play w AA30", response);
+		EXPECT_EQ("=\n\n", response);
+	}
+
+	TEST(PoolTest, TestNestedParallelFor) {
+		ThreadPool pool(4);
+		std::vector<int> hits(16 * 100);
+
+		// Every outer chunk waits on inner chunks queued to the same pool.
+		pool.parallelFor(0, 16, 1, [&](size_t first, size_t last) {
+			for (size_t outer = first; outer < last; ++outer)
+			{
+				pool.parallelFor(0, 100, 7, [&](size_t from, size_t to) {
+					for (size_t i = from; i < to; ++i)
+					{
+						++hits[outer * 100 + i];
+					}
+				});
+			}
+		});
+		for (auto h : hits)
+		{
+			ASSERT_EQ(1, h);
+		}
+	}
+
+	TEST(PoolTest, TestReduce) {
+		ThreadPool pool(4);
+
+		long long sum = pool.reduce(0, 10000, 333, 0LL,
+			[](size_t first, size_t last) {
+				long long s{ 0 };
+				for (size_t i = first; i < last; ++i)
+				{
+					s += static_cast<long long>(i);
+				}
+				return s;
+			},
+			[](long long a, long long b) { return a + b; });
+		EXPECT_EQ(9999LL * 10000 / 2, sum);
+		// The partial results are combined in order.
+		std::string order = pool.reduce(0, 10, 3, std::string(),
+			[](size_t first, size_t last) { return std::to_string(first) + "-" + std::to_string(last) + " "; },
+			[](const std::string& a, const std::string& b) { return a + b; });
+		EXPECT_EQ("0-3 3-6 6-9 9-10 ", order);
+		EXPECT_EQ(42, pool.reduce(5, 5, 1, 42, [](size_t, size_t) { return 0; }, [](int a, int b) { return a + b; }));
+	}
+
+	TEST(CacheTest, TestSaveAndLoad) {
+		std::remove("cache-test.hxc");
+		SearchCache cache(100, 16);
+		std::vector<int> wins{ 10, 20, 30 };
+
+		// 3 nodes of 50 playouts are kept, 2 of 10 are too few.
+		cache.store(1, 50, wins);
+		cache.store(2, 10, { 4, 5 });
+		EXPECT_EQ(1u, cache.size());
+		ASSERT_EQ(1, cache.save("cache-test.hxc"));
+		// The saved file is mapped and still answers.
+		std::vector<int> found(3);
+		EXPECT_EQ(50u, cache.lookup(1, found));
+		EXPECT_EQ(wins, found);
+
+		SearchCache loaded(100, 16);
+		ASSERT_TRUE(loaded.open("cache-test.hxc"));
+		EXPECT_EQ(1u, loaded.size());
+		found.assign(3, 0);
+		EXPECT_EQ(50u, loaded.lookup(1, found));
+		EXPECT_EQ(wins, found);
+		std::vector<int> other(2);
+		EXPECT_EQ(0u, loaded.lookup(2, other));
+		// The same key with a different number of empty nodes is a collision.
+		EXPECT_EQ(0u, loaded.lookup(1, other));
+		std::remove("cache-test.hxc");
+		EXPECT_FALSE(loaded.open("cache-test.hxc"));
+		EXPECT_EQ(0u, loaded.size());
+	}
+
+	// Overwrites a 64 bit field of a saved cache.
+	static void patchCache(const char* file, std::streamoff at, std::uint64_t value)
+	{
+		std::fstream out(file, std::ios::in | std::ios::out | std::ios::binary);
+		out.seekp(at);
+		out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+	}
+
+	TEST(CacheTest, TestBadEntriesAreRejected) {
+		std::remove("cache-test.hxc");
+		{
+			SearchCache cache(10, 16);
+			cache.store(1, 50, { 1, 2, 3 });
+			cache.store(2, 50, { 4, 5, 6 });
+			ASSERT_EQ(2, cache.save("cache-test.hxc"));
+		}
+		// The header is 16 bytes, then entries of key, first, count and
+		// rounds.  A rejected file is unmapped again, so it can be patched.
+		SearchCache loaded;
+		// The first entry's counts past the end, wrapping around as well.
+		patchCache("cache-test.hxc", 24, ~0ull);
+		EXPECT_FALSE(loaded.open("cache-test.hxc"));
+		patchCache("cache-test.hxc", 24, 4);
+		EXPECT_FALSE(loaded.open("cache-test.hxc"));
+		// Keys out of order.
+		patchCache("cache-test.hxc", 24, 0);
+		patchCache("cache-test.hxc", 16, 3);
+		EXPECT_FALSE(loaded.open("cache-test.hxc"));
+		patchCache("cache-test.hxc", 16, 1);
+		EXPECT_TRUE(loaded.open("cache-test.hxc"));
+		EXPECT_FALSE(loaded.open("missing.hxc"));
+		std::remove("cache-test.hxc");
+	}
+
+	TEST(CacheTest, TestCapacityKeepsTheMostPlayed) {
+		std::remove("cache-test.hxc");
+		SearchCache cache(1, 2);
+
+		cache.store(1, 10, { 1 });
+		cache.store(2, 30, { 1 });
+		cache.store(3, 20, { 1 });
+		EXPECT_EQ(3u, cache.size());
+		ASSERT_EQ(2, cache.save("cache-test.hxc"));
+		std::vector<int> found(1);
+		EXPECT_EQ(0u, cache.lookup(1, found));
+		EXPECT_EQ(30u, cache.lookup(2, found));
+		EXPECT_EQ(20u, cache.lookup(3, found));
+		std::remove("cache-test.hxc");
+	}
+
+	TEST(CacheTest, TestSaveReplacesTheMappedFile) {
+		std::remove("cache-test.hxc");
+		{
+			SearchCache first(1, 16);
+			first.store(1, 5, { 1, 2 });
+			first.store(2, 5, { 3, 4 });
+			ASSERT_EQ(2, first.save("cache-test.hxc"));
+		}
+		// The old file stays mapped while the new one is written beside it.
+		SearchCache cache(1, 16);
+		ASSERT_TRUE(cache.open("cache-test.hxc"));
+		cache.store(2, 7, { 5, 6 });
+		cache.store(3, 9, { 7, 8 });
+		ASSERT_EQ(3, cache.save("cache-test.hxc"));
+		EXPECT_FALSE(std::ifstream("cache-test.hxc.tmp").good());
+
+		SearchCache loaded(1, 16);
+		ASSERT_TRUE(loaded.open("cache-test.hxc"));
+		std::vector<int> found(2);
+		EXPECT_EQ(5u, loaded.lookup(1, found));
+		// The fresh search wins over the one in the old file.
+		EXPECT_EQ(7u, loaded.lookup(2, found));
+		EXPECT_EQ(std::vector<int>({ 5, 6 }), found);
+		EXPECT_EQ(9u, loaded.lookup(3, found));
+		std::remove("cache-test.hxc");
+	}
+
+	// A swap table that takes over every opening on 3x3.
+	static void writeSwapEverything(const char* file)
+	{
+		std::ofstream out(file, std::ios::binary);
+		std::uint32_t header[3]{ 1, 1, 3 };
+		std::vector<float> rates(9, 1.0f);
+		out.write("HXSW", 4);
+		out.write(reinterpret_cast<const char*>(header), sizeof(header));
+		out.write(reinterpret_cast<const char*>(rates.data()), rates.size() * sizeof(float));
+	}
+
+	TEST(GameTest, TestPieRuleSwapsSeatsAndColors) {
+		writeSwapEverything("swap-test.hxw");
+		SwapTable table;
+		ASSERT_TRUE(table.load("swap-test.hxw"));
+		std::remove("records-test.hxr");
+		GameRecordWriter recorder;
+		ASSERT_TRUE(recorder.open("records-test.hxr"));
+
+		// The human opens in the middle and then tries the cells in order,
+		// the occupied ones are turned down.
+		std::istringstream input("1 1\n0 0\n0 1\n0 2\n1 0\n1 2\n2 0\n2 1\n2 2\n");
+		std::streambuf* keyboard = std::cin.rdbuf(input.rdbuf());
+		HexGame h(3);
+		h.setRender(false);
+		h.setPieRule(true, &table);
+		h.setRecorder(&recorder);
+		::testing::internal::CaptureStdout();
+		h.play();
+		std::string output = ::testing::internal::GetCapturedStdout();
+		std::cin.rdbuf(keyboard);
+		ASSERT_TRUE(recorder.close());
+
+		GameRecordReader reader;
+		ASSERT_TRUE(reader.open("records-test.hxr"));
+		GameRecord g;
+		ASSERT_TRUE(reader.next(g));
+		// The computer now owns the blue opening and the human answers as red
+		// with the first cell left.
+		ASSERT_GE(g.moves.size(), 2u);
+		EXPECT_EQ(4, g.moves[0]);
+		EXPECT_EQ(0, g.moves[1]);
+		Board b(3);
+		for (size_t i = 0; i < g.moves.size(); ++i)
+		{
+			b.setColor(g.moves[i], (0 == i % 2) ? Color::COLOR_BLUE : Color::COLOR_RED);
+		}
+		EXPECT_EQ(g.winner, b.winner());
+		EXPECT_NE(std::string::npos, output.find("Computer swaps and takes over the first move."));
+		const char* message = (Color::COLOR_BLUE == g.winner) ? "Computer has won the game." : "Player one has won the game.";
+		EXPECT_NE(std::string::npos, output.find(message));
+		std::remove("records-test.hxr");
+		std::remove("swap-test.hxw");
+	}
+
+	TEST(EngineTest, TestSpecsAreReadWhole) {
+		EXPECT_NE(nullptr, makeEngine("uct:5"));
+		EXPECT_NE(nullptr, makeEngine("mc:5"));
+		EXPECT_NE(nullptr, makeEngine("uct-resistance:4:2"));
+		EXPECT_EQ(nullptr, makeEngine("uct:5abc"));
+		EXPECT_EQ(nullptr, makeEngine("mc:5abc"));
+		EXPECT_EQ(nullptr, makeEngine("uct-resistance:4:2x"));
+		EXPECT_EQ(nullptr, makeEngine("uct:-1"));
+	}
+
+	// Differential tests
+	// Every faster way of finding the winner has to agree with the original
+	// one: edges from getNeighbor into a Graph and a path search between the
+	// player's sides.  The sides are joined to two extra nodes so that one
+	// path search stands in for one per pair of side nodes.  Random games at
+	// every size go through each backend, which reports the move that won
+	// and by whom, and the time it took over all games.
+	struct Outcome
+	{
+		int move;
+		Color winner;
+		bool operator==(const Outcome& o) const { return move == o.move && winner == o.winner; }
+	};
+
+	struct Backend
+	{
+		const char* name;
+		std::function<Outcome(int, const std::vector<int>&)> play;
+		double seconds;
+		long long games;
+	};
+
+	static Outcome referencePlay(int size, const std::vector<int>& moves)
+	{
+		int nodes = size * size;
+		Board b(size);
+		Graph blue(nodes + 2);
+		Graph red(nodes + 2);
+		for (int i = 0; i < nodes; ++i)
+		{
+			int n = moves[i];
+			Color c = (0 == i % 2) ? Color::COLOR_BLUE : Color::COLOR_RED;
+			Graph& g = (Color::COLOR_BLUE == c) ? blue : red;
+			int start = (Color::COLOR_BLUE == c) ? b.col(n) : b.row(n);
+			b.setColor(n, c);
+			for (auto m : b.getNeighbor(n, c))
+			{
+				g.addEdge(n, m);
+			}
+			if (0 == start)
+			{
+				g.addEdge(nodes, n);
+			}
+			if (size - 1 == start)
+			{
+				g.addEdge(nodes + 1, n);
+			}
+			if (g.path(nodes, nodes + 1))
+			{
+				return Outcome{ i, c };
+			}
+		}
+		return Outcome{ nodes, Color::COLOR_BLANK };
+	}
+
+	static Outcome floodFillPlay(int size, const std::vector<int>& moves)
+	{
+		Board b(size);
+		for (int i = 0; i < size * size; ++i)
+		{
+			b.setColor(moves[i], (0 == i % 2) ? Color::COLOR_BLUE : Color::COLOR_RED);
+			Color winner = b.winner();
+			if (Color::COLOR_BLANK != winner)
+			{
+				return Outcome{ i, winner };
+			}
+		}
+		return Outcome{ size * size, Color::COLOR_BLANK };
+	}
+
+	static Outcome unionFindPlay(int size, const std::vector<int>& moves)
+	{
+		Board b(size);
+		Connectivity connect(size);
+		for (int i = 0; i < size * size; ++i)
+		{
+			b.setColor(moves[i], (0 == i % 2) ? Color::COLOR_BLUE : Color::COLOR_RED);
+			connect.play(b, moves[i]);
+			if (Color::COLOR_BLANK != connect.winner())
+			{
+				return Outcome{ i, connect.winner() };
+			}
+		}
+		return Outcome{ size * size, Color::COLOR_BLANK };
+	}
+
+	// The neighbors of every node, of every color, by getNeighbor and by the
+	// neighbor table.
+	static void compareNeighbors(Board& b)
+	{
+		for (int n = 0; n < b.size() * b.size(); ++n)
+		{
+			for (auto c : { Color::COLOR_BLUE, Color::COLOR_RED, Color::COLOR_BLANK })
+			{
+				std::vector<int> expected = b.getNeighbor(n, c);
+				std::vector<int> actual;
+				for (int dir = 0; dir < 6; ++dir)
+				{
+					int m = b.neighborAt(n, dir);
+					if (m >= 0 && c == b.getColor(m))
+					{
+						actual.push_back(m);
+					}
+				}
+				std::sort(expected.begin(), expected.end());
+				std::sort(actual.begin(), actual.end());
+				ASSERT_EQ(expected, actual) << "node " << n << " on " << b.size() << "x" << b.size();
+			}
+		}
+	}
+
+	static void differential(int games, bool report)
+	{
+		std::vector<Backend> backends{
+			{ "getNeighbor + Graph::path", referencePlay, 0.0, 0 },
+			{ "Board::winner", floodFillPlay, 0.0, 0 },
+			{ "Connectivity", unionFindPlay, 0.0, 0 },
+		};
+		Random r;
+		for (int size = 1; size <= 19; ++size)
+		{
+			std::vector<int> moves(size * size);
+			for (int game = 0; game < games; ++game)
+			{
+				for (int n = 0; n < size * size; ++n)
+				{
+					moves[n] = n;
+				}
+				r.shuffle(moves);
+				Outcome expected{};
+				for (auto& backend : backends)
+				{
+					Timer t;
+					Outcome outcome = backend.play(size, moves);
+					backend.seconds += t.elapsed();
+					++backend.games;
+					if (&backend == &backends.front())
+					{
+						expected = outcome;
+						ASSERT_NE(Color::COLOR_BLANK, expected.winner);
+					}
+					ASSERT_TRUE(expected == outcome) << backend.name << " on " << size << "x" << size << " game " << game;
+				}
+				// The neighbor sets are compared on the position the game ended in.
+				Board b(size);
+				for (int i = 0; i <= expected.move; ++i)
+				{
+					b.setColor(moves[i], (0 == i % 2) ? Color::COLOR_BLUE : Color::COLOR_RED);
+				}
+				compareNeighbors(b);
+				if (::testing::Test::HasFatalFailure())
+				{
+					return;
+				}
+			}
+		}
+		if (!report)
+		{
+			return;
+		}
+		for (auto& backend : backends)
+		{
+			std::cout << backend.name << ": " << backend.games << " games in " << backend.seconds << " seconds, "
+			          << backend.games / backend.seconds << " games/sec, "
+			          << backends.front().seconds / backend.seconds << "x the reference" << std::endl;
+		}
+	}
+
+	TEST(DifferentialTest, TestBackendsAgreeWithGetNeighbor) {
+		differential(20, false);
+	}
+
+	// Millions of games, with a throughput report.  Run with
+	//   --gtest_also_run_disabled_tests --gtest_filter=DifferentialTest.*
+	TEST(DifferentialTest, DISABLED_TestMillionsOfGames) {
+		differential(100000, true);
 	}
 } // namespace
 
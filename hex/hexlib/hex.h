@@ -0,0 +1,1208 @@
+// hex.h
+// The Hex engine: board, connectivity, playouts and search, game records,
+// books and caches, and the tools built on them.  Everything declared here
+// is built into the hexlib static library, which the hex program, the mcs
+// simulator and the tests all link against.  hex_c.h has a C interface to
+// the same code.
+#pragma once
+#include <iostream>
+#include <vector>
+#include <tuple>
+#include <queue>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <string>
+#include <sstream>
+#include <limits>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <cctype>
+#include <fstream>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <cmath>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <unordered_map>
+
+// Credit: http://www.learncpp.com/cpp-tutorial/8-16-timing-your-code/
+class Timer
+{
+private:
+    using clock_t = std::chrono::high_resolution_clock;
+    using second_t = std::chrono::duration<double, std::ratio<1>>;
+
+    std::chrono::time_point<clock_t> m_beg;
+
+public:
+    Timer() : m_beg(clock_t::now())
+    {}
+
+    void reset()
+    {
+        m_beg = clock_t::now();
+    }
+
+    double elapsed() const
+    {
+        return std::chrono::duration_cast<second_t>(clock_t::now() - m_beg).count();
+    }
+};
+
+// A random generator to assist with random int and double values
+// Credit: http://www.learncpp.com/cpp-tutorial/59-random-number-generation/
+class Random
+{
+private:
+    std::random_device m_rd;
+    std::mt19937 m_mersenne;
+
+public:
+    Random() {
+        m_mersenne = std::mt19937(m_rd());
+    };
+    double getRandom(double start, double end)
+    {
+        std::uniform_real_distribution<double> dist{ start, end };
+
+        double result = dist(m_mersenne);
+        return result;
+    }
+
+    int getRandom(int start, int end)
+    {
+        std::uniform_int_distribution<int> dist{ start, end };
+
+        int result = dist(m_mersenne);
+        return result;
+    }
+
+    template <typename T>
+    void shuffle(std::vector<T>& v)
+    {
+        std::shuffle(v.begin(), v.end(), m_mersenne);
+    }
+};
+
+// A work stealing thread pool.  Every worker has its own deque of tasks:
+// it pushes and pops at the back, and idle workers steal from the front
+// of the others.  Tasks submitted from outside the pool are dealt out
+// round robin.
+//
+// A thread waiting in parallelFor only helps with the chunks of that same
+// parallelFor, so nested parallel loops (a tournament game running a
+// parallel search) can't pile unrelated work on top of each other.
+//
+// The whole program shares one pool, ThreadPool::shared(), so the
+// searches, playouts, analysis and self-play never start more threads than
+// the machine has cores.  configure() and pin() set it up before first use.
+class ThreadPool
+{
+private:
+    struct Task
+    {
+        std::function<void()> fn;
+        const void* group;
+    };
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> m_queues;
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::atomic<int> m_pending{ 0 };
+    std::atomic<unsigned> m_next{ 0 };
+    bool m_stop{ false };
+    static thread_local ThreadPool* t_pool;
+    static thread_local int t_index;
+    void push(Task task);
+    bool take(Task& task, const void* group);
+    void worker(int index);
+public:
+    ThreadPool(int threads, bool pin = false);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    int size() const { return static_cast<int>(m_threads.size()); }
+    // The calling worker's index, or size() for a thread outside the pool.
+    // Handy for per worker scratch space indexed 0..size().
+    int workerIndex() const { return (this == t_pool) ? t_index : size(); }
+    void submit(std::function<void()> fn);
+    // Calls fn(first, last) over [begin, end) in chunks of grain and waits
+    // for all of them.  The calling thread runs chunks too.
+    void parallelFor(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& fn);
+    // map(first, last) gives a partial result per chunk and combine folds
+    // them together, in order, starting from init.
+    template <typename T, typename Map, typename Combine>
+    T reduce(size_t begin, size_t end, size_t grain, T init, Map map, Combine combine)
+    {
+        grain = std::max<size_t>(grain, 1);
+        size_t chunks = (end > begin) ? (end - begin + grain - 1) / grain : 0;
+        std::vector<T> partial(chunks, init);
+        parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+            for (size_t c = first; c < last; ++c)
+            {
+                size_t from = begin + c * grain;
+                partial[c] = map(from, std::min(from + grain, end));
+            }
+        });
+        T result = init;
+        for (auto& p : partial)
+        {
+            result = combine(result, p);
+        }
+        return result;
+    }
+    // The number of workers of the shared pool, one per core by default.
+    static void configure(int threads);
+    // Ties each worker of the shared pool to a core of its own.
+    static void pin(bool pinned);
+    static ThreadPool& shared();
+};
+
+// Probes
+// Counters and cycle timers on the hot paths, built in when the library is
+// compiled with HEX_PROBES defined (/D HEX_PROBES, -DHEX_PROBES).  Every
+// thread adds to its own slots without locking; Probes::write sums them
+// up, on demand, as JSON or Prometheus text.
+enum class Probe : int { NEIGHBOR, WIN_CHECK, PLAYOUT, SEARCH_EXPAND, SEARCH_SELECT, BOOK_PROBE, LEAF_BATCH, COUNT };
+
+class Probes
+{
+public:
+    enum class Format { JSON, PROMETHEUS };
+    static const char* name(Probe p);
+    static bool enabled();
+    // Totals over all threads, past and present.
+    static void totals(std::vector<std::uint64_t>& calls, std::vector<std::uint64_t>& cycles);
+    static void write(std::ostream& out, Format format);
+};
+
+// Parses all of s as an int.
+bool toInt(const std::string& s, int& value);
+// Parses all of s as a double.
+bool toDouble(const std::string& s, double& value);
+
+//  Traditional Header definitions here
+static const int DefaultBoardSize{ 11 };
+enum class Color : std::int8_t { COLOR_BLANK = 0, COLOR_BLUE = 1, COLOR_RED = 2 };
+typedef std::tuple<unsigned int, unsigned int> Coord;
+// Inside the engine a node is a dense row * size + col index, and move
+// lists, records and search state hold it as a Cell.  Row and column only
+// come into it at the UI.  NoCell marks no move; it is why boards stop at
+// MaxBoardSize.
+typedef std::uint16_t Cell;
+static const Cell NoCell{ 0xFFFF };
+static const int MaxBoardSize{ 255 };
+// The biggest board GTP accepts.  Past 26 columns are named like
+// spreadsheet columns, z then aa.  From 19x19 on the engines keep every
+// per game structure O(nodes) and searches in a fixed size arena.
+static const int LargeBoardSize{ 32 };
+
+// Graph ADT
+// Every node keeps a list of (neighbor, cost) pairs.  A hex node never has
+// more than 6 neighbors, so this stays small where an nxn matrix would be
+// megabytes on a big board.  A missing edge has a cost of INT_MAX which
+// means not connected.
+class Graph {
+private:
+    int m_size;
+    std::vector<bool> m_visited;
+    std::vector<int> m_distance;
+    std::vector< std::vector<std::pair<int, int>>> m_edges;
+    void setCost(int i, int j, int cost);
+public:
+    Graph(int size=DefaultBoardSize) :m_size{ size }
+    {
+        // Initially the nodes are not connected.
+        m_edges.resize(m_size);
+    }
+    void addEdge(int i, int j, int cost=1) { setCost(i, j, cost); setCost(j, i, cost); }
+    void delEdge(int i, int j) { setCost(i, j, INT_MAX); setCost(j, i, INT_MAX); }
+    int  getCost(int i, int j) const;
+    bool hasEdge(int i, int j) const { return getCost(i, j) != INT_MAX; }
+    // Determine if there is a path between src and dst.
+    bool path(int src, int dst);
+    std::vector<int> neighbors(int i);
+
+    friend std::ostream& operator<<(std::ostream& out, const Graph& g);
+};
+
+
+// Board ADT
+// Zobrist style key for a stone of color c on node n.  The keys are mixed
+// from the node and color (splitmix64) rather than drawn from a table, so
+// they are the same on every run and every platform, and for any board
+// size.  Position hashes end up in book files.
+inline std::uint64_t zobrist(std::uint64_t n, Color c)
+{
+    if (Color::COLOR_BLANK == c)
+    {
+        return 0;
+    }
+    std::uint64_t z = (n << 2 | static_cast<std::uint64_t>(c)) + 0x9e3779b97f4a7c15ull;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+class Board
+{
+private:
+    int m_size;
+    std::vector<Color> m_nodes;
+    // Hash of the stones on the board, kept up to date by setColor.
+    std::uint64_t m_hash;
+
+    std::vector<Cell> m_east;
+    std::vector<Cell> m_west;
+    std::vector<Cell> m_north;
+    std::vector<Cell> m_south;
+    // Six neighbors per node, shared by all boards of this size.
+    const Cell* m_adj;
+
+public:
+    Board(int size = DefaultBoardSize);
+    int get_node(Coord p) const { return std::get<0>(p) * m_size + std::get<1>(p); }
+    Coord get_point(int n) const { return Coord{n / m_size, n % m_size}; }
+    // Conversions for the UI, the engine itself only deals in Cells.
+    Cell cell(int row, int col) const { return static_cast<Cell>(row * m_size + col); }
+    int row(Cell n) const { return n / m_size; }
+    int col(Cell n) const { return n % m_size; }
+    bool isTopLeftCorner(const Coord& p) { return std::get<0>(p) == 0 && std::get<1>(p) == 0; }
+    bool isTopRightCorner(const Coord& p) { return std::get<0>(p) == 0 && std::get<1>(p) == m_size - 1; };
+    bool isBotLeftCorner(const Coord& p) { return std::get<0>(p) == m_size - 1 && std::get<1>(p) == 0; }
+    bool isBotRightCorner(const Coord& p) { return std::get<0>(p) == m_size - 1 && std::get<1>(p) == m_size - 1; }
+    bool isCorner(const Coord& p) { return isTopLeftCorner(p) || isTopRightCorner(p) || isBotLeftCorner(p) || isBotRightCorner(p); }
+    bool isTop(const Coord& p) { return 0 == std::get<0>(p); }
+    bool isBottom(const Coord& p) { return (m_size - 1) == std::get<0>(p); }
+    bool isLHS(const Coord& p) { return 0 == std::get<1>(p); }
+    bool isRHS(const Coord& p) { return (m_size - 1) == std::get<1>(p); }
+    bool isInner(const Coord& p) { return !isTop(p) && !isBottom(p) && !isLHS(p) && !isRHS(p); }
+    bool isBlank(int n) const { return m_nodes[n] == Color::COLOR_BLANK; }
+    bool isOccupied(int n) const { return !isBlank(n); }
+    int size() const { return m_size; }
+    Color getColor(int n) const { return m_nodes[n]; }
+    void setColor(int n, Color c) { m_hash ^= zobrist(n, m_nodes[n]) ^ zobrist(n, c); m_nodes[n] = c; }
+    std::uint64_t hash() const { return m_hash; }
+    std::vector<Cell> east() { return m_east; }
+    std::vector<Cell> west() { return m_west; }
+    std::vector<Cell> north() { return m_north; }
+    std::vector<Cell> south() { return m_south; }
+    bool isWithinBoundary(Coord p);
+    bool isAvailable(Coord p) { return isWithinBoundary(p) && isBlank(get_node(p)); }
+    std::vector<int> getNeighbor(int n, Color c);
+    int neighborAt(int n, int dir) const { return (NoCell == m_adj[6 * n + dir]) ? -1 : m_adj[6 * n + dir]; }
+    int pattern(int n, Color c) const;
+    Color winner() const;
+    void clear() { std::fill(m_nodes.begin(), m_nodes.end(), Color::COLOR_BLANK); m_hash = emptyHash(); }
+    std::uint64_t emptyHash() const { return zobrist(static_cast<std::uint64_t>(m_size) << 32, Color::COLOR_RED); }
+    void draw(std::string& frame) const;
+
+    friend std::ostream& operator<<(std::ostream& out, const Board& b);
+};
+
+// Connectivity ADT
+// Union-find over the nodes plus the four sides, so the winner is known
+// after every stone at near constant cost instead of a search over the
+// board.
+class Connectivity
+{
+private:
+    int m_size;
+    std::vector<int> m_parent;
+    int find(int n);
+    void join(int a, int b);
+    int east() const { return m_size * m_size; }
+    int west() const { return east() + 1; }
+    int north() const { return east() + 2; }
+    int south() const { return east() + 3; }
+public:
+    Connectivity(int size = DefaultBoardSize) : m_size{ size } { clear(); }
+    void clear();
+    // Adds the stone on n, b already holding it.  Stones can be added in
+    // any order.
+    void play(const Board& b, int n);
+    Color winner();
+};
+
+// Pattern ADT
+// A pattern is what surrounds an empty node, seen from the side of the
+// player about to move.  Each of the 6 neighbor slots (in the getNeighbor
+// order) holds one of four states, so a pattern fits in 12 bits.
+enum class Slot : std::int8_t { EMPTY = 0, OWN = 1, OPPONENT = 2, EDGE = 3 };
+static const int NumPatterns{ 1 << 12 };
+
+// Bradley-Terry strength (gamma) for every pattern.  The computer samples
+// its moves in proportion to the gamma of the pattern around each empty node.
+// The binary table is: "HXPW", version, count, then count floats.
+class PatternWeights
+{
+private:
+    std::vector<float> m_gamma;
+public:
+    PatternWeights() : m_gamma(NumPatterns, 1.0f) {}
+    float gamma(int pattern) const { return m_gamma[pattern]; }
+    void setGamma(int pattern, float g) { m_gamma[pattern] = g; }
+    bool load(const std::string& file);
+    bool save(const std::string& file) const;
+    int sample(const Board& b, Color c, Random& r) const;
+};
+
+// A played game as read from a self-play log.  The text format is one game
+// per line:
+//   <size> <winner> <node> <node> ...
+// where winner is the Color value and the moves alternate starting with blue.
+// The binary format (see GameRecordWriter) also keeps the player names.
+struct GameRecord
+{
+    int size{ 0 };
+    Color winner{ Color::COLOR_BLANK };
+    std::string blue;
+    std::string red;
+    std::vector<Cell> moves;
+};
+bool readGameRecord(std::istream& in, GameRecord& g);
+
+// Calls fn for every game in a log file, text or binary.  Returns false if
+// the file can't be read.
+bool forEachGame(const std::string& file, const std::function<void(const GameRecord&)>& fn);
+
+// A read only view of a whole file mapped into memory.
+class MappedFile
+{
+private:
+    const unsigned char* m_data{ nullptr };
+    size_t m_size{ 0 };
+#ifdef _WIN32
+    // HANDLEs, kept as void* so that this header doesn't need windows.h.
+    void* m_file;
+    void* m_mapping{ nullptr };
+#endif
+public:
+    MappedFile();
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    bool open(const std::string& file);
+    void close();
+    const unsigned char* data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
+
+// Binary game records.  The file starts with "HXGR" and a version, then
+// holds blocks of games:
+//   <payload bytes> <game count> <FNV-1a checksum of payload> <payload>
+// The three block fields are 32 bit.  Each game in the payload is
+//   size, winner, blue name, red name, move count, moves
+// with every number a varint and the names as varint length plus bytes,
+// so a move on boards up to 11x11 takes one byte.
+//
+// The writer only ever appends.  Games are encoded into one buffer while a
+// background thread writes the other one out, so the caller never waits on
+// the disk unless both buffers are full.  It is not thread safe, callers
+// serialize their writes.
+class GameRecordWriter
+{
+private:
+    std::ofstream m_out;
+    std::string m_front;
+    std::string m_back;
+    std::uint32_t m_front_games{ 0 };
+    std::uint32_t m_back_games{ 0 };
+    bool m_back_full{ false };
+    bool m_done{ false };
+    // Set by the background thread once a write to the file fails.
+    bool m_failed{ false };
+    std::mutex m_mutex;
+    std::condition_variable m_cv;
+    std::thread m_thread;
+    void handOff();
+    void flusher();
+public:
+    static const size_t BlockSize{ 1 << 16 };
+    GameRecordWriter() {}
+    ~GameRecordWriter() { close(); }
+    bool open(const std::string& file);
+    void write(const GameRecord& g);
+    // Writes out what is left.  False if any of the games didn't make it
+    // to the file, a full disk for instance.
+    bool close();
+};
+
+// Reads binary game records straight out of the mapped file.  Checksums
+// are checked as each block is entered, and reading stops at the first
+// damaged or truncated block.
+class GameRecordReader
+{
+private:
+    MappedFile m_file;
+    const unsigned char* m_next{ nullptr };
+    const unsigned char* m_block_end{ nullptr };
+    size_t m_offset{ 0 };
+    bool m_verify{ true };
+    bool m_corrupt{ false };
+    bool nextBlock();
+public:
+    bool open(const std::string& file, bool verify = true);
+    bool next(GameRecord& g);
+    bool corrupt() const { return m_corrupt; }
+};
+
+class Tablebase;
+
+// Offline fitting of the pattern weights with Coulom's minorization-maximization
+// for the Bradley-Terry model.  Every move in the logs is a competition between
+// the patterns of all empty nodes, won by the pattern of the node played.
+// Each iteration is one streaming pass over the shards, one task per shard
+// on the shared thread pool.
+class PatternTuner
+{
+private:
+    std::vector<std::string> m_shards;
+    bool m_winner_only;
+    // With a table for the games' size, a move only counts if it keeps
+    // the mover winning.
+    const Tablebase* m_tablebase{ nullptr };
+    PatternWeights m_weights;
+    std::vector<double> m_wins;
+    long long m_moves{ 0 };
+    void accumulate(const std::string& shard, std::vector<double>& wins,
+                    std::vector<double>& denominator, long long& moves, bool count_wins) const;
+public:
+    PatternTuner(const std::vector<std::string>& shards, bool winner_only = false)
+        : m_shards{ shards }, m_winner_only{ winner_only } {}
+    void setTablebase(const Tablebase* table) { m_tablebase = table; }
+    void run(int iterations);
+    long long moves() const { return m_moves; }
+    const PatternWeights& weights() const { return m_weights; }
+};
+
+enum class PlayerType : std::int8_t { HUMAN = 0, COMPUTER };
+class Player
+{
+private:
+    PlayerType m_type;
+    std::vector<Cell> m_moves;
+public:
+    Player(PlayerType t) : m_type{ t } {}
+    PlayerType type() const { return m_type; }
+    void setMove(Cell n) { m_moves.push_back(n); }
+    // The pie rule: the players change seats, the stones stay put.
+    void swapSides(Player& other) { std::swap(m_type, other.m_type); }
+    const std::vector<Cell>& moves() const { return m_moves; }
+};
+
+class SearchCache;
+
+// Engine ADT
+// Anything that can pick a move for color c on a board, within a time
+// budget given in seconds.  Engines keep scratch state, so each thread
+// needs its own.
+class Engine
+{
+public:
+    virtual ~Engine() {}
+    virtual std::string name() const = 0;
+    virtual int genmove(const Board& b, Color c, double seconds) = 0;
+    // Engines that search can carry their statistics over in a cache.
+    virtual void setCache(SearchCache*) {}
+};
+
+// Uniformly random legal moves, as the original computer player.
+class RandomEngine : public Engine
+{
+private:
+    Random m_random;
+public:
+    std::string name() const override { return "random"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+};
+
+// Moves sampled from tuned pattern weights.
+class PolicyEngine : public Engine
+{
+private:
+    PatternWeights m_weights;
+    Random m_random;
+public:
+    PolicyEngine(const PatternWeights& weights) : m_weights{ weights } {}
+    std::string name() const override { return "policy"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+};
+
+// What a thread needs to run random playouts without allocating.  Each
+// thread keeps one, see playoutScratch().
+struct PlayoutScratch
+{
+    Random random;
+    Board board;
+    std::vector<Cell> fill;
+};
+
+// Plays move for c and then fills the rest of the board at random.
+Color playout(const Board& b, const std::vector<Cell>& empty, int move, Color c, PlayoutScratch& s);
+PlayoutScratch& playoutScratch();
+
+// Search cache
+// Keeps the statistics of the searches that ran many playouts, so a later
+// search of the same position, in this process or the next, carries on
+// from them instead of starting from nothing.  The file is written at
+// shutdown:
+//   "HXSC", version, entry count (64 bit), entries, win counts
+// The entries are sorted by key and point into the win counts, one per
+// empty node of the position in node order.  Like the opening book the
+// file is mapped and searched in place, so starting up costs nothing and
+// only the pages of the positions actually played are read.
+struct CacheEntry
+{
+    std::uint64_t key;
+    std::uint64_t first;
+    std::uint32_t count;
+    std::uint32_t rounds;
+};
+
+class SearchCache
+{
+private:
+    struct Stats
+    {
+        std::uint32_t rounds;
+        std::vector<std::uint32_t> wins;
+    };
+    MappedFile m_file;
+    const CacheEntry* m_entries{ nullptr };
+    const std::uint32_t* m_wins{ nullptr };
+    size_t m_count{ 0 };
+    // The searches of this run, which win over the file.
+    std::unordered_map<std::uint64_t, Stats> m_fresh;
+    long long m_min_playouts;
+    size_t m_capacity;
+    mutable std::mutex m_mutex;
+public:
+    // Only searches of at least min_playouts are kept, and at most
+    // capacity positions are written, the most played ones.
+    SearchCache(long long min_playouts = 1000, size_t capacity = 1 << 16)
+        : m_min_playouts{ min_playouts }, m_capacity{ capacity } {}
+    // Maps a cache written by save.  A missing or stale file leaves the
+    // cache empty but still usable.
+    bool open(const std::string& file);
+    size_t size() const;
+    // The key of the position b with c to move.
+    static std::uint64_t key(const Board& b, Color c);
+    // Fills wins with the win counts of the position's wins.size() empty
+    // nodes and returns the playouts per node, or 0 if it isn't known.
+    std::uint32_t lookup(std::uint64_t key, std::vector<int>& wins) const;
+    void store(std::uint64_t key, std::uint32_t rounds, const std::vector<int>& wins);
+    // Writes the old and new positions to file and maps it.  Returns the
+    // number of positions written or -1.
+    long long save(const std::string& file);
+};
+
+// Flat Monte Carlo search: every empty node gets the same share of random
+// playouts and the one that wins most often is played.  The search keeps
+// its state between calls to step, so it can be run a slice at a time,
+// from any thread.  Each round of playouts is spread over the shared
+// thread pool.  With a cache the search starts from the playouts of any
+// earlier search of the position, and commit() adds its own.
+class MonteCarloSearch
+{
+private:
+    std::vector<Cell> m_empty;
+    std::vector<int> m_wins;
+    Color m_color{ Color::COLOR_BLUE };
+    long long m_played{ 0 };
+    SearchCache* m_cache{ nullptr };
+    std::uint64_t m_key{ 0 };
+public:
+    void setCache(SearchCache* cache) { m_cache = cache; }
+    void start(const Board& b, Color c);
+    // Runs whole rounds of playouts until budget playouts are done or
+    // seconds have passed, at least one round.  Returns true once the
+    // budget is met.
+    bool step(const Board& b, long long budget, double seconds);
+    long long played() const { return m_played; }
+    // The most successful node so far, -1 on a full board.
+    int best() const;
+    // Hands the statistics so far to the cache, if there is one.
+    void commit();
+    // Gives back the memory of a finished search.
+    void release() { std::vector<Cell>().swap(m_empty); std::vector<int>().swap(m_wins); }
+};
+
+// The flat Monte Carlo search as an engine.  With a playout budget the
+// time budget is ignored.
+class MonteCarloEngine : public Engine
+{
+private:
+    int m_playouts;
+    MonteCarloSearch m_search;
+public:
+    MonteCarloEngine(int playouts = 0) : m_playouts{ playouts } {}
+    std::string name() const override { return "mc"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+    void setCache(SearchCache* cache) override { m_search.setCache(cache); }
+};
+
+// Resistance evaluation
+// Each side's connection is modelled as an electrical circuit: a cell of
+// its own has almost no resistance, an empty cell 1 and an opponent's cell
+// cuts it off.  Neighbors are joined with the sum of their resistances and
+// the two sides the player joins are held at potentials 1 and 0.  The
+// better connected side carries more current, so the share of blue's
+// conductance in the total says who is ahead.
+//
+// The potentials come from a conjugate gradient solve, Jacobi
+// preconditioned, done in place over the board's neighbor table.  The
+// potentials of a position are a good start for the position one stone
+// later, which cuts the iterations to a handful.
+struct Potentials
+{
+    std::vector<float> blue;
+    std::vector<float> red;
+    // The iterations the two solves took.
+    int iterations{ 0 };
+};
+
+class ResistanceEvaluator
+{
+private:
+    double m_tolerance;
+public:
+    // The solve stops when the residual is down to tolerance times the
+    // source, the right hand side, so a warm start ends at the same
+    // accuracy as a cold one, only sooner.
+    ResistanceEvaluator(double tolerance = 1e-4) : m_tolerance{ tolerance } {}
+    // Blue's share of the conductance, 0 to 1.  Starts from warm if given
+    // and leaves the potentials in out if given.
+    double evaluate(const Board& b, const Potentials* warm = nullptr, Potentials* out = nullptr) const;
+    // Evaluates count boards over the shared thread pool.  warm and out can
+    // be null, or hold an entry for each board.
+    void evaluate(const Board* const* boards, size_t count, double* values,
+                  const Potentials* const* warm = nullptr, Potentials* out = nullptr) const;
+};
+
+// UCT search
+// A game tree searched with UCB1.  A leaf gets its children once it has
+// been visited, and every descent ends in a random playout.  The winner
+// is followed incrementally on the way down, so won positions stop the
+// descent and never grow children.
+//
+// Children are ranked by a static guess from their local pattern and start
+// with a few virtual visits won as often as that guess says.  A node only
+// gets its best few children at first and is widened to more, in the same
+// order, as its visits grow, so the tree doesn't spend memory and early
+// visits on all the moves of a big board.  The root gets all of its
+// children at once.
+//
+// All nodes live in one arena of fixed capacity.  When an expansion
+// doesn't fit, the arena is compacted: the children of the least visited
+// nodes are dropped, their own statistics kept, until at most half of it
+// is in use.  So memory stays the same however long the search runs and
+// however big the board.
+//
+// With an evaluator the leaves are scored by it instead of played out.
+// The search then descends batch times before scoring anything, counting
+// each descent as a lost visit on its way down (a virtual loss) so the
+// next one is steered elsewhere.  The whole batch goes to the evaluator in
+// one call, warm started from the root's potentials, and the values are
+// backed up together.
+struct UctNode
+{
+    std::uint32_t first;    // The first child in the arena, 0 until expanded
+    std::uint32_t visits;
+    // For the player who made move.  A float for the fractional priors and
+    // leaf values, so past 2^24 (about 16 million) a single win no longer
+    // adds to it.
+    float wins;
+    Cell move;
+    std::uint16_t count;    // The number of children
+};
+
+class UctSearch
+{
+private:
+    size_t m_capacity;
+    std::vector<UctNode> m_nodes;
+    std::vector<UctNode> m_spare;
+    size_t m_used{ 0 };
+    bool m_full{ false };
+    Color m_color{ Color::COLOR_BLUE };
+    long long m_played{ 0 };
+    long long m_recycled{ 0 };
+    // Scratch space for the descents, kept to avoid allocating.
+    Connectivity m_root;
+    Board m_board;
+    Connectivity m_connect;
+    std::vector<std::uint32_t> m_path;
+    std::vector<Cell> m_fill;
+    Random m_random;
+    // Leaf batching: the paths of the batch end to end, where each one
+    // starts, and the leaves' boards.
+    const ResistanceEvaluator* m_evaluator{ nullptr };
+    size_t m_batch{ 1 };
+    Potentials m_potentials;
+    std::vector<std::uint32_t> m_paths;
+    std::vector<size_t> m_starts;
+    std::vector<Board> m_leaves;
+    std::vector<const Board*> m_pending;
+    std::vector<double> m_values;
+    std::vector<const Potentials*> m_warm;
+    long long m_batches{ 0 };
+    double m_batch_seconds{ 0.0 };
+    // Priors and widening.  The jitter per node, drawn for each search,
+    // breaks ties between priors the same way every time a node is widened.
+    bool m_widen{ true };
+    int m_root_empty{ 0 };
+    std::vector<float> m_prior;
+    std::vector<float> m_jitter;
+    bool expand(std::uint32_t n, size_t want, Color turn);
+    std::uint32_t select(std::uint32_t n) const;
+    Color descend(const Board& b);
+    void backup(const std::uint32_t* path, size_t length, double blue, bool visit);
+    void gather(const Board& b, size_t count);
+    void recycle();
+public:
+    // capacity nodes, 16 bytes each.
+    UctSearch(size_t capacity = 1 << 20) : m_capacity{ std::max<size_t>(capacity, 2) } {}
+    // Scores leaves with evaluator, batch at a time, instead of playouts.
+    void setEvaluator(const ResistanceEvaluator* evaluator, size_t batch);
+    // Off, every node gets all its children at once, with no priors.
+    void setWidening(bool widen) { m_widen = widen; }
+    void start(const Board& b, Color c);
+    // Runs playouts until budget playouts are done or seconds have
+    // passed, at least one.  Returns true once the budget is met.
+    bool step(const Board& b, long long budget, double seconds);
+    long long played() const { return m_played; }
+    // The most visited node so far, -1 on a full or won board.
+    int best() const;
+    size_t nodes() const { return m_used; }
+    // The nodes dropped to make room so far.
+    long long recycled() const { return m_recycled; }
+    // The batches scored so far and the time they took in the evaluator.
+    long long batches() const { return m_batches; }
+    double batchSeconds() const { return m_batch_seconds; }
+};
+
+// The UCT search as an engine.  With a playout budget the time budget is
+// ignored.
+class UctEngine : public Engine
+{
+private:
+    int m_playouts;
+    UctSearch m_search;
+    ResistanceEvaluator m_evaluator;
+    bool m_evaluated{ false };
+public:
+    UctEngine(int playouts = 0, size_t capacity = 1 << 20) : m_playouts{ playouts }, m_search{ capacity } {}
+    // Scores the leaves with the resistance evaluator, batch at a time.
+    void useEvaluator(size_t batch) { m_search.setEvaluator(&m_evaluator, batch); m_evaluated = true; }
+    std::string name() const override { return m_evaluated ? "uct-resistance" : "uct"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+};
+
+// Plays the empty node whose resulting position evaluates best, all of
+// them evaluated in one batch warm started from the current position.
+class ResistanceEngine : public Engine
+{
+private:
+    ResistanceEvaluator m_evaluator;
+    std::vector<Board> m_children;
+    std::vector<const Board*> m_batch;
+    std::vector<int> m_moves;
+    std::vector<double> m_values;
+    std::vector<const Potentials*> m_warm;
+    Potentials m_root;
+public:
+    std::string name() const override { return "resistance"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+};
+
+// Builds an engine from a command line spec:
+//   random | policy:<weights.bin> | mc[:<playouts>] | uct[:<playouts>] | resistance
+//   | uct-resistance[:<evaluations>[:<batch>]] | perfect:<table.hxt>
+// optionally followed by @<book.hxb> to play from an opening book first.
+// Returns nullptr if the spec is not understood.
+std::unique_ptr<Engine> makeEngine(const std::string& spec);
+
+// Opening book
+// A file of positions, sorted by hash, each with the move to play:
+//   "HXOB", version, entry count (64 bit), entries
+// The book is mapped read only and searched in place, so opening even a
+// huge book costs nothing up front and only the pages touched are read.
+struct BookEntry
+{
+    std::uint64_t key;
+    std::uint32_t move;
+    std::uint32_t games;
+};
+
+class OpeningBook
+{
+private:
+    MappedFile m_file;
+    const BookEntry* m_entries{ nullptr };
+    size_t m_count{ 0 };
+public:
+    bool open(const std::string& file);
+    size_t size() const { return m_count; }
+    // The book move for the position, or -1 if it isn't in the book.
+    int lookup(const Board& b) const;
+};
+
+// Builds a book from played games.  For every position within the first
+// depth moves, the move with the best win rate over at least min_games
+// games is kept.
+class BookBuilder
+{
+private:
+    struct Observation
+    {
+        std::uint64_t key;
+        std::uint32_t move;
+        std::uint32_t win;
+        bool operator<(const Observation& o) const { return key < o.key || (key == o.key && move < o.move); }
+    };
+    int m_depth;
+    int m_min_games;
+    std::vector<Observation> m_observations;
+public:
+    BookBuilder(int depth, int min_games) : m_depth{ depth }, m_min_games{ min_games } {}
+    void add(const GameRecord& g);
+    size_t observations() const { return m_observations.size(); }
+    // Returns the number of positions written, or -1 on error.
+    long long write(const std::string& file);
+};
+
+// Plays from the book while the position is in it, then hands over to the
+// wrapped engine.
+class BookEngine : public Engine
+{
+private:
+    OpeningBook m_book;
+    std::unique_ptr<Engine> m_engine;
+public:
+    BookEngine(std::unique_ptr<Engine> engine) : m_engine{ std::move(engine) } {}
+    bool open(const std::string& file) { return m_book.open(file); }
+    std::string name() const override { return m_engine->name() + "+book"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+    void setCache(SearchCache* cache) override { m_engine->setCache(cache); }
+};
+
+// Tablebase
+// Every position of a small board solved outright.  Blue moves first, so
+// the stone count alone says how many stones each side has and whose turn
+// it is.  Positions are numbered by a perfect hash: by stone count, then by
+// the rank of the occupied nodes among all sets of that many nodes, then by
+// the rank of the blue stones among the occupied ones.  Hex has no draws,
+// so one bit per position, set when blue wins, is all there is to store:
+//   "HXTB", version, size, 0, 64 bit words of bits
+// The file is mapped read only like the opening book.  It is built from the
+// full board back to the empty one, each stone count spread over the shared
+// thread pool.  4x4 takes 1.3 MB; 5x5 would take 20 GB and is refused.
+class Tablebase
+{
+private:
+    MappedFile m_file;
+    int m_size{ 0 };
+    const std::uint64_t* m_bits{ nullptr };
+    // The first index of each stone count.
+    std::vector<std::uint64_t> m_levels;
+public:
+    bool open(const std::string& file);
+    int size() const { return m_size; }
+    // The position's index, or -1 if the board is another size or the
+    // stones can't have been played with blue moving first.
+    long long index(const Board& b) const;
+    // Who wins with perfect play, blank for positions not in the table.
+    Color winner(const Board& b) const;
+    // A move that keeps c winning, -1 if c loses or it isn't c's turn.
+    int bestMove(const Board& b, Color c) const;
+    // Bits the table for a size board takes, -1 if it is too large.
+    static long long bits(int size);
+    static bool build(int size, const std::string& file);
+};
+
+// Plays perfectly from a tablebase and falls back on flat Monte Carlo for
+// other sizes, or once the position is lost.
+class PerfectEngine : public Engine
+{
+private:
+    Tablebase m_table;
+    MonteCarloEngine m_fallback;
+public:
+    bool open(const std::string& file) { return m_table.open(file); }
+    std::string name() const override { return "perfect"; }
+    int genmove(const Board& b, Color c, double seconds) override;
+    void setCache(SearchCache* cache) override { m_fallback.setCache(cache); }
+};
+
+// Analyzer ADT
+// Estimates, for one position, how each node ends up from a large number
+// of random playouts.  The playouts are split into chunks on the shared
+// thread pool, each worker adds to its own counters, and the counters are
+// summed at the end.
+//   ownership  how often the node ended up blue
+//   win rate   how often the player to move won when they ended up owning
+//              the node, the usual "where should I play" heat map
+struct Analysis
+{
+    Color to_move{ Color::COLOR_BLUE };
+    double win{ 0.0 };
+    std::vector<double> ownership;
+    std::vector<double> win_rate;
+};
+
+class Analyzer
+{
+private:
+    struct Counters
+    {
+        long long wins{ 0 };
+        std::vector<long long> blue;
+        std::vector<long long> owned;
+        std::vector<long long> owned_wins;
+    };
+    long long m_playouts;
+    std::vector<Counters> m_counters;
+    void playouts(const Board& b, Color to_move, long long count, Counters& counters);
+public:
+    Analyzer(long long playouts) : m_playouts{ playouts } {}
+    void analyze(const Board& b, Analysis& a);
+};
+
+// Positions to analyze, one per line as "<size> <node> <node> ...", moves
+// alternating from blue.  Binary game records work too, in which case the
+// position after the first ply moves of each game is used.  Returns false
+// if the file can't be read.
+bool forEachPosition(const std::string& file, int ply, const std::function<void(const Board&)>& fn);
+
+// GameHost ADT
+// Hosts many games at once against remote players on the shared thread
+// pool.  Every game is a small state machine:
+//   WAITING   the remote player is to move, the game costs no thread and
+//             sits in no queue
+//   READY     the engine is to move and the game is in the run queue
+//   FINISHED  someone has connected
+// The engine search runs in slices.  Every game put in the queue comes
+// with one task on the pool; the task takes the game at the front of the
+// queue, runs one slice of its search and, unless the search is done, puts
+// it at the back with a fresh task, so every game thinking at the same
+// time gets the same share of the workers.  The search state only lives
+// while the engine is thinking, so the memory of an idle game is its board.
+//
+// The engine's moves are reported through the callback, called on a pool
+// thread with the host unlocked; it may call play() straight away.
+class GameHost
+{
+public:
+    enum class State : std::int8_t { WAITING, READY, FINISHED };
+    // game id, engine move, winner (COLOR_BLANK while the game goes on)
+    typedef std::function<void(int, int, Color)> MoveCallback;
+private:
+    struct HostedGame
+    {
+        Board board;
+        // Who has connected, updated with every stone.
+        Connectivity connect;
+        Color engine;
+        Color turn{ Color::COLOR_BLUE };
+        State state{ State::WAITING };
+        MonteCarloSearch search;
+        bool searching{ false };
+        std::chrono::steady_clock::time_point ready;
+        HostedGame(int size, Color c) : board{ size }, connect{ size }, engine{ c } {}
+    };
+    long long m_playouts;
+    double m_slice;
+    MoveCallback m_callback;
+    std::vector<std::unique_ptr<HostedGame>> m_games;
+    std::deque<int> m_ready;
+    int m_tasks{ 0 };
+    int m_finished{ 0 };
+    bool m_stop{ false };
+    double m_total_latency{ 0.0 };
+    double m_max_latency{ 0.0 };
+    long long m_engine_moves{ 0 };
+    SearchCache* m_cache{ nullptr };
+    std::mutex m_mutex;
+    std::condition_variable m_done;
+    void schedule(int game);
+    void enqueue(int game);
+    void slice();
+public:
+    GameHost(long long playouts, double slice, MoveCallback callback);
+    ~GameHost();
+    // The searches of the games opened from now on share cache.
+    void setCache(SearchCache* cache) { m_cache = cache; }
+    // Starts a game with the engine playing color c and returns its id.
+    int open(int size, Color c);
+    // The remote player's move.  Returns false if it isn't their turn or
+    // the move is illegal.
+    bool play(int game, int node);
+    // Blocks until every game opened so far has finished.
+    void waitAll();
+    long long engineMoves() const { return m_engine_moves; }
+    double averageLatency() const { return m_engine_moves ? m_total_latency / m_engine_moves : 0.0; }
+    double maxLatency() const { return m_max_latency; }
+};
+
+// GTP ADT
+// A text protocol session, in the style of GTP as used by Hex programs
+// (HTP).  Commands come one per line, optionally preceded by a number id,
+// and the state persists between commands.  Black is the first player
+// (blue, joining east to west) and white is the second (red).  Nodes are
+// written as a column letter and a row number, so a1 is node 0.
+//
+// The board, history and engine are kept from command to command, so
+// apart from boardsize changing the size nothing gets reallocated.
+class GtpSession
+{
+private:
+    Board m_board;
+    Connectivity m_connect;
+    std::vector<Cell> m_history;
+    std::unique_ptr<Engine> m_engine;
+    double m_main_time{ 0.0 };
+    double m_byo_yomi_time{ 1.0 };
+    int m_byo_yomi_stones{ 1 };
+    std::vector<std::string> m_args;
+    size_t m_argc{ 0 };
+    std::string m_response;
+    bool m_quit{ false };
+    bool parseColor(const std::string& s, Color& c) const;
+    bool parseNode(const std::string& s, int& n) const;
+    void formatNode(int n, std::string& out) const;
+    double moveTime() const;
+    bool dispatch(const std::string& command);
+public:
+    GtpSession(std::unique_ptr<Engine> engine, int size = DefaultBoardSize)
+        : m_board{ size }, m_connect{ size }, m_engine{ std::move(engine) } { m_history.reserve(size * size); }
+    // Runs one command line and leaves the reply, framed as the protocol
+    // wants it, in response.  Returns false once quit has been seen.
+    bool execute(const std::string& line, std::string& response);
+    void run(std::istream& in, std::ostream& out);
+};
+
+// Tournament ADT
+// Plays engine against engine on the shared thread pool and reports the
+// score of the first engine as an Elo difference.  Colors alternate every game and
+// the first opening moves can be randomized so games don't repeat.
+struct TournamentConfig
+{
+    std::string first{ "mc" };
+    std::string second{ "random" };
+    int size{ 7 };
+    int games{ 100 };
+    double seconds{ 0.1 };
+    int opening{ 0 };
+    std::string log;
+    std::string record;
+};
+
+class Tournament
+{
+private:
+    // A pair of engines and scratch for one game at a time.  Seats are
+    // reused from game to game but never shared by two running games.
+    struct Seat
+    {
+        std::unique_ptr<Engine> first;
+        std::unique_ptr<Engine> second;
+        Random random;
+        GameRecord record;
+    };
+    TournamentConfig m_config;
+    std::vector<std::unique_ptr<Seat>> m_seats;
+    std::mutex m_mutex;
+    std::ofstream m_log;
+    GameRecordWriter m_writer;
+    bool m_recording{ false };
+    int m_first_wins{ 0 };
+    int m_blue_wins{ 0 };
+    int m_played{ 0 };
+    double m_elapsed{ 0.0 };
+    void playOne(int g);
+public:
+    Tournament(const TournamentConfig& config) : m_config{ config } {}
+    bool run();
+    void report(std::ostream& out) const;
+};
+
+// Plays one game between two engines.  The moves, opening included, are
+// stored in the record.  Returns the winner.
+Color playGame(Engine& blue, Engine& red, int size, int opening, double seconds, Random& r, GameRecord& record);
+
+// Swap table
+// The first player's win rate for every opening move, per board size, so
+// the pie rule decision after the first move is a lookup.  The table is
+// worked out offline with "hex swaptable" and loaded at startup:
+//   "HXSW", version, size count, then per size: size, size*size floats
+class SwapTable
+{
+private:
+    std::unordered_map<int, std::vector<float>> m_rates;
+public:
+    bool load(const std::string& file);
+    bool save(const std::string& file) const;
+    bool has(int size) const { return m_rates.count(size) > 0; }
+    // The first player's chance after opening on n, -1 if unknown.
+    double rate(int size, int n) const;
+    // Rates every opening on a size board by the best of the replies a
+    // flat Monte Carlo search finds with playouts per reply.  The openings
+    // are spread over the shared thread pool.
+    void generate(int size, long long playouts);
+};
+
+// Hex ADT
+// Hex is a game
+// Hex has a board
+// Hex has a players
+// Hex has a moves
+
+class HexGame
+{
+private:
+    int m_size;
+    Player m_first_player{ PlayerType::HUMAN };
+    Player m_second_player{ PlayerType::COMPUTER };
+    Board m_board;
+    // Who has connected so far, updated with every move.
+    Connectivity m_connect;
+    const PatternWeights* m_policy;
+    // With the pie rule the second player may take over the first move,
+    // the players then swap colors.
+    bool m_pie_rule{ false };
+    bool m_swapped{ false };
+    const SwapTable* m_swap_table{ nullptr };
+    bool shouldSwap(Cell first) const;
+    // With rendering off the game runs headless and only the result is
+    // printed.  With it on, each frame is built in m_frame and written once.
+    bool m_render{ true };
+    std::string m_frame;
+    GameRecordWriter* m_recorder{ nullptr };
+    const OpeningBook* m_book{ nullptr };
+    void render();
+public:
+    HexGame(int size, const PatternWeights* policy = nullptr) : m_size{ size }, m_board{ size }, m_connect{ size }, m_policy{ policy } {}
+    void setRender(bool render) { m_render = render; }
+    void setFirstPlayer(PlayerType t) { m_first_player = Player(t); }
+    void setRecorder(GameRecordWriter* recorder) { m_recorder = recorder; }
+    void setBook(const OpeningBook* book) { m_book = book; }
+    void setPieRule(bool pie, const SwapTable* table = nullptr) { m_pie_rule = pie; m_swap_table = table; }
+    void play();
+    Cell getUserMove();
+    Cell getAIMove(Color c);
+    void record(Color winner);
+
+};
+
+// End of hex header
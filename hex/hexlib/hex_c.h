@@ -0,0 +1,64 @@
+/* hex_c.h
+ * A C interface to the Hex engine in hexlib, for callers that can't use
+ * the C++ API in hex.h: other languages through an FFI, scripts, and tools
+ * that have to stay binary compatible across compilers.  The calls work on
+ * batches of boards, so one call can keep every core busy and the cost of
+ * crossing the interface is paid once per batch rather than per board.
+ *
+ * Colors are HEX_BLANK, HEX_BLUE (moves first, joins east to west) and
+ * HEX_RED (joins north to south).  Nodes are numbered row * size + col.
+ * Boards and engines are opaque handles; none of the calls keep a pointer
+ * to the arrays passed in.  No call throws: running out of memory shows
+ * up as the error value each call documents.
+ */
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped whenever a call or a meaning changes. */
+#define HEX_API_VERSION 1
+
+enum { HEX_BLANK = 0, HEX_BLUE = 1, HEX_RED = 2 };
+
+typedef struct hex_board hex_board;
+typedef struct hex_engine hex_engine;
+
+/* The HEX_API_VERSION the library was built with. */
+int hex_api_version(void);
+
+/* An empty board, or NULL if size is out of range or memory ran out. */
+hex_board* hex_board_new(int size);
+void hex_board_free(hex_board* board);
+int hex_board_size(const hex_board* board);
+void hex_board_clear(hex_board* board);
+/* The color on node, or -1 if there is no such node. */
+int hex_board_get(const hex_board* board, int node);
+/* Plays count moves with the colors alternating, starting with first.
+ * Stops at the first illegal move and returns the number of moves played. */
+int hex_board_play(hex_board* board, const int* nodes, int count, int first);
+
+/* winners[i] is the color that has connected on boards[i], or HEX_BLANK.
+ * All of them are -1 if the call failed. */
+void hex_winners(const hex_board* const* boards, int count, int* winners);
+
+/* Random playouts from each board with colors[i] to move.  win_rates[i] is
+ * the share of the playouts won by colors[i], all of them -1 if the call
+ * failed. */
+void hex_playouts(const hex_board* const* boards, const int* colors, int count, int playouts, double* win_rates);
+
+/* An engine from a spec as used by hex selfplay, e.g. "mc:1000" or
+ * "policy:weights.bin@book.hxb", or NULL if the spec isn't understood or
+ * memory ran out. */
+hex_engine* hex_engine_new(const char* spec);
+void hex_engine_free(hex_engine* engine);
+/* moves[i] is the engine's move for colors[i] on boards[i], -1 on a full
+ * board or a bad color, and all of them -1 if the call failed.  The boards
+ * are searched one after another, each search using all the cores, with
+ * seconds per board. */
+void hex_genmove(hex_engine* engine, const hex_board* const* boards, const int* colors, int count, double seconds, int* moves);
+
+#ifdef __cplusplus
+}
+#endif